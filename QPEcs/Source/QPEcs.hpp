@@ -3,4 +3,5 @@
 //Forward declarations
 #include "QPEcs/Views/View.hpp"
 
-#include "QPEcs/EntityComponentSystem.hpp"
\ No newline at end of file
+#include "QPEcs/EntityComponentSystem.hpp"
+#include "QPEcs/World.hpp"
\ No newline at end of file
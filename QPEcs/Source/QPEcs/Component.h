@@ -1,10 +1,20 @@
 #pragma once
 #include "Types.h"
 #include <bitset>
+#include <tuple>
+#include <type_traits>
 
 namespace QPEcs
 {
 	constexpr ComponentType MaxComponents = 64;
 
 	using Signature = std::bitset<MaxComponents>;
+
+	// Empty components carry no data and are only stored as a bit in the entity's signature.
+	template <class Component>
+	constexpr bool IsTagComponent = std::is_empty_v<Component>;
+
+	// The components that carry data, tag components are left out.
+	template <class ... Components>
+	using DataComponents = decltype(std::tuple_cat(std::declval<std::conditional_t<IsTagComponent<Components>, std::tuple<>, std::tuple<Components>>>()...));
 }
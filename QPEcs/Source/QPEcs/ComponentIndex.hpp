@@ -0,0 +1,198 @@
+#pragma once
+#include "Entity.hpp"
+#include <map>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace QPEcs
+{
+	// Specialize for a component to have its registry keep an index on one of its fields:
+	// template <> struct QPEcs::ComponentIndex<NetworkId> : QPEcs::HashIndex<&NetworkId::id> {};
+	template <class Component>
+	struct ComponentIndex
+	{
+		static constexpr bool IsIndexed = false;
+	};
+
+	// Indexed components are handed out read-only, their fields can only change through PatchComponent.
+	template <class Component>
+	using ComponentReference = std::conditional_t<ComponentIndex<Component>::IsIndexed, const Component&, Component&>;
+
+	template <class Field>
+	struct FieldTraits;
+
+	template <class Component, class Key>
+	struct FieldTraits<Key Component::*>
+	{
+		using ComponentType = Component;
+		using KeyType = Key;
+	};
+
+	template <auto Field>
+	class HashIndex
+	{
+		public:
+			using Component = typename FieldTraits<decltype(Field)>::ComponentType;
+			using Key = typename FieldTraits<decltype(Field)>::KeyType;
+
+			static constexpr bool IsIndexed = true;
+
+			void Insert(Entity aEntity, const Component& aComponent);
+
+			void Erase(Entity aEntity);
+
+			void Update(Entity aEntity, const Component& aComponent);
+
+			std::vector<Entity> Find(const Key& aKey) const;
+
+		private:
+			// Entities are kept in a set per key so removing one doesn't scan every entity sharing its key.
+			std::unordered_map<Key, std::unordered_set<Entity>> myEntities {};
+			std::unordered_map<Entity, Key> myKeys {};
+	};
+
+	template <auto Field>
+	class OrderedIndex
+	{
+		public:
+			using Component = typename FieldTraits<decltype(Field)>::ComponentType;
+			using Key = typename FieldTraits<decltype(Field)>::KeyType;
+
+			static constexpr bool IsIndexed = true;
+
+			void Insert(Entity aEntity, const Component& aComponent);
+
+			void Erase(Entity aEntity);
+
+			void Update(Entity aEntity, const Component& aComponent);
+
+			std::vector<Entity> Find(const Key& aKey) const;
+
+			// Returns the entities whose key lies within [aMin, aMax].
+			std::vector<Entity> FindRange(const Key& aMin, const Key& aMax) const;
+
+		private:
+			using Map = std::multimap<Key, Entity>;
+
+			Map myEntities {};
+			// Each entity's position in the map, so it can be erased without searching its key's range.
+			std::unordered_map<Entity, typename Map::iterator> myPositions {};
+	};
+
+	template <auto Field>
+	void HashIndex<Field>::Insert(Entity aEntity, const Component& aComponent)
+	{
+		const Key& key = aComponent.*Field;
+		myEntities[key].insert(aEntity);
+		myKeys[aEntity] = key;
+	}
+
+	template <auto Field>
+	void HashIndex<Field>::Erase(Entity aEntity)
+	{
+		auto keyIt = myKeys.find(aEntity);
+		if (keyIt == myKeys.end())
+		{
+			return;
+		}
+
+		auto entitiesIt = myEntities.find(keyIt->second);
+		entitiesIt->second.erase(aEntity);
+		if (entitiesIt->second.empty())
+		{
+			myEntities.erase(entitiesIt);
+		}
+
+		myKeys.erase(keyIt);
+	}
+
+	template <auto Field>
+	void HashIndex<Field>::Update(Entity aEntity, const Component& aComponent)
+	{
+		auto keyIt = myKeys.find(aEntity);
+		if (keyIt != myKeys.end() && keyIt->second == aComponent.*Field)
+		{
+			return;
+		}
+
+		Erase(aEntity);
+		Insert(aEntity, aComponent);
+	}
+
+	template <auto Field>
+	std::vector<Entity> HashIndex<Field>::Find(const Key& aKey) const
+	{
+		auto entitiesIt = myEntities.find(aKey);
+		if (entitiesIt == myEntities.end())
+		{
+			return {};
+		}
+
+		return std::vector<Entity>(entitiesIt->second.begin(), entitiesIt->second.end());
+	}
+
+	template <auto Field>
+	void OrderedIndex<Field>::Insert(Entity aEntity, const Component& aComponent)
+	{
+		myPositions[aEntity] = myEntities.emplace(aComponent.*Field, aEntity);
+	}
+
+	template <auto Field>
+	void OrderedIndex<Field>::Erase(Entity aEntity)
+	{
+		auto positionIt = myPositions.find(aEntity);
+		if (positionIt == myPositions.end())
+		{
+			return;
+		}
+
+		myEntities.erase(positionIt->second);
+		myPositions.erase(positionIt);
+	}
+
+	template <auto Field>
+	void OrderedIndex<Field>::Update(Entity aEntity, const Component& aComponent)
+	{
+		auto positionIt = myPositions.find(aEntity);
+		if (positionIt != myPositions.end() && positionIt->second->first == aComponent.*Field)
+		{
+			return;
+		}
+
+		Erase(aEntity);
+		Insert(aEntity, aComponent);
+	}
+
+	template <auto Field>
+	std::vector<Entity> OrderedIndex<Field>::Find(const Key& aKey) const
+	{
+		std::vector<Entity> entities;
+
+		auto [first, last] = myEntities.equal_range(aKey);
+		for (auto it = first; it != last; ++it)
+		{
+			entities.push_back(it->second);
+		}
+
+		return entities;
+	}
+
+	template <auto Field>
+	std::vector<Entity> OrderedIndex<Field>::FindRange(const Key& aMin, const Key& aMax) const
+	{
+		std::vector<Entity> entities;
+		if (aMax < aMin)
+		{
+			return entities;
+		}
+
+		for (auto it = myEntities.lower_bound(aMin), last = myEntities.upper_bound(aMax); it != last; ++it)
+		{
+			entities.push_back(it->second);
+		}
+
+		return entities;
+	}
+}
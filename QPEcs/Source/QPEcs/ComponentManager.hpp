@@ -1,12 +1,25 @@
 #pragma once
 #include "Entity.hpp"
 #include "Types.h"
+#include "Component.h"
 #include "ComponentRegistry.hpp"
+#include "Threading.hpp"
+#include <algorithm>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 namespace QPEcs
 {
+	// A component that can be sent in deltas, identified across worlds by an id derived from its type name.
+	struct ReplicatedComponent
+	{
+		ComponentId myId {};
+		ComponentType myType {};
+		// Tag components don't have a registry.
+		ComponentRegistryBase* myRegistry { nullptr };
+	};
+
 	class ComponentManager
 	{
 		using TypeName = const char*;
@@ -24,51 +37,143 @@ namespace QPEcs
 			void RemoveComponent(Entity aEntity);
 
 			template <class Component>
-			Component& GetComponent(Entity aEntity);
+			ComponentReference<Component> GetComponent(Entity aEntity);
 
 			template <class Component>
 			inline void CopyComponent(Entity aFrom, Entity aTo);
 
+			template <class Component, class Function>
+			void PatchComponent(Entity aEntity, Function&& aFunction);
+
+			template <class Component>
+			void MarkChanged(Entity aEntity);
+
+			template <class Component, class Key>
+			std::vector<Entity> FindByIndex(const Key& aKey);
+
+			template <class Component, class Key>
+			std::vector<Entity> FindByIndexRange(const Key& aMin, const Key& aMax);
+
 			template <class Component>
 			bool IsRegistered();
 
 			void OnEntityDestroyed(Entity aEntity);
 
+			uint32_t GetTick() const;
+
+			void SetTick(uint32_t aTick);
+
+			template <class Function>
+			void ForEachReplicatedComponent(Function&& aFunction) const;
+
+			const ReplicatedComponent* FindReplicatedComponent(ComponentId aId) const;
+
 		private:
 			std::unordered_map<TypeName, ComponentType> myComponentTypes {};
 			std::unordered_map<TypeName, std::shared_ptr<ComponentRegistryBase>> myComponentRegistries {};
 			ComponentType myNextComponentType{};
+			std::vector<ReplicatedComponent> myReplicatedComponents {};
+			uint32_t myTick { 1 };
+			mutable SharedMutex myMutex {};
 
 			template <class Component>
 			std::shared_ptr<ComponentRegistry<Component>> GetComponentRegistry();
 
 			template <class Component>
 			TypeName GetTypeName();
+
+			static ComponentId GetComponentId(TypeName aTypeName);
 	};
 
 	template <class Component>
 	inline bool ComponentManager::IsRegistered()
 	{
+		ReadLock lock(myMutex);
 		return myComponentTypes.contains(GetTypeName<Component>());
 	}
 
 	inline void ComponentManager::OnEntityDestroyed(Entity aEntity)
 	{
+		ReadLock lock(myMutex);
 		for (auto const& [typeName, component] : myComponentRegistries)
 		{
 			component->OnEntityDestroyed(aEntity);
 		}
 	}
 
+	inline uint32_t ComponentManager::GetTick() const
+	{
+		ReadLock lock(myMutex);
+		return myTick;
+	}
+
+	inline void ComponentManager::SetTick(uint32_t aTick)
+	{
+		WriteLock lock(myMutex);
+		myTick = aTick;
+		for (auto const& [typeName, component] : myComponentRegistries)
+		{
+			component->SetTick(aTick);
+		}
+	}
+
+	template <class Function>
+	void ComponentManager::ForEachReplicatedComponent(Function&& aFunction) const
+	{
+		ReadLock lock(myMutex);
+		for (const ReplicatedComponent& component : myReplicatedComponents)
+		{
+			aFunction(component);
+		}
+	}
+
+	inline const ReplicatedComponent* ComponentManager::FindReplicatedComponent(ComponentId aId) const
+	{
+		ReadLock lock(myMutex);
+		for (const ReplicatedComponent& component : myReplicatedComponents)
+		{
+			if (component.myId == aId)
+			{
+				return &component;
+			}
+		}
+
+		return nullptr;
+	}
+
 	template <class Component>
 	void ComponentManager::RegisterComponent()
 	{
 		if (!IsRegistered<Component>())
 		{
-			assert(!myComponentTypes.contains(GetTypeName<Component>()) && "Component has already been registered!");
+			WriteLock lock(myMutex);
+			if (myComponentTypes.contains(GetTypeName<Component>()))
+			{
+				// Another thread registered it while we were waiting for the lock.
+				return;
+			}
 
 			myComponentTypes[GetTypeName<Component>()] = myNextComponentType++;
-			myComponentRegistries[GetTypeName<Component>()] = std::make_shared<ComponentRegistry<Component>>();
+
+			const ComponentType componentType = myComponentTypes[GetTypeName<Component>()];
+
+			ComponentRegistryBase* registry = nullptr;
+			if constexpr (!IsTagComponent<Component>)
+			{
+				auto componentRegistry = std::make_shared<ComponentRegistry<Component>>();
+				componentRegistry->SetTick(myTick);
+				registry = componentRegistry.get();
+				myComponentRegistries[GetTypeName<Component>()] = std::move(componentRegistry);
+			}
+
+			if constexpr (IsReplicatedComponent<Component>)
+			{
+				const ComponentId componentId = GetComponentId(GetTypeName<Component>());
+				assert(std::none_of(myReplicatedComponents.begin(), myReplicatedComponents.end(), [componentId](const ReplicatedComponent& aComponent) { return aComponent.myId == componentId; })
+					&& "Two replicated components share the same id!");
+
+				myReplicatedComponents.push_back({ componentId, componentType, registry });
+			}
 		}
 	}
 
@@ -76,7 +181,9 @@ namespace QPEcs
 	ComponentType ComponentManager::GetComponentType()
 	{
 		RegisterComponent<Component>();
-		return myComponentTypes[GetTypeName<Component>()];
+
+		ReadLock lock(myMutex);
+		return myComponentTypes.at(GetTypeName<Component>());
 	}
 
 	template <class Component, class ... Args>
@@ -92,7 +199,7 @@ namespace QPEcs
 	}
 
 	template <class Component>
-	Component& ComponentManager::GetComponent(Entity aEntity)
+	ComponentReference<Component> ComponentManager::GetComponent(Entity aEntity)
 	{
 		return GetComponentRegistry<Component>()->GetComponent(aEntity);
 	}
@@ -101,17 +208,44 @@ namespace QPEcs
 	template <class Component>
 	void ComponentManager::CopyComponent(Entity aFrom, Entity aTo)
 	{
-		assert(myComponentTypes.contains(GetTypeName<Component>()) && "You need to register components before copying them!");
+		assert(IsRegistered<Component>() && "You need to register components before copying them!");
 
 		GetComponentRegistry<Component>()->CopyComponent(aFrom, aTo);
 	}
 
+	template <class Component, class Function>
+	void ComponentManager::PatchComponent(Entity aEntity, Function&& aFunction)
+	{
+		GetComponentRegistry<Component>()->PatchComponent(aEntity, std::forward<Function>(aFunction));
+	}
+
+	template <class Component>
+	void ComponentManager::MarkChanged(Entity aEntity)
+	{
+		GetComponentRegistry<Component>()->MarkChanged(aEntity);
+	}
+
+	template <class Component, class Key>
+	std::vector<Entity> ComponentManager::FindByIndex(const Key& aKey)
+	{
+		return GetComponentRegistry<Component>()->FindByIndex(aKey);
+	}
+
+	template <class Component, class Key>
+	std::vector<Entity> ComponentManager::FindByIndexRange(const Key& aMin, const Key& aMax)
+	{
+		return GetComponentRegistry<Component>()->FindByIndexRange(aMin, aMax);
+	}
+
 	template <class Component>
 	std::shared_ptr<ComponentRegistry<Component>> ComponentManager::GetComponentRegistry()
 	{
+		static_assert(!IsTagComponent<Component>, "Tag components don't have a registry!");
+
+		ReadLock lock(myMutex);
 		assert(myComponentTypes.contains(GetTypeName<Component>()) && "You need to register components before using them!");
 
-		return std::static_pointer_cast<ComponentRegistry<Component>>(myComponentRegistries[GetTypeName<Component>()]);
+		return std::static_pointer_cast<ComponentRegistry<Component>>(myComponentRegistries.at(GetTypeName<Component>()));
 	}
 
 	template <class Component>
@@ -119,4 +253,17 @@ namespace QPEcs
 	{
 		return typeid(Component).name();
 	}
+
+	inline ComponentId ComponentManager::GetComponentId(TypeName aTypeName)
+	{
+		// FNV-1a, so the same component gets the same id in every world.
+		ComponentId id = 2166136261u;
+		for (const char* character = aTypeName; *character != '\0'; character++)
+		{
+			id ^= static_cast<uint8_t>(*character);
+			id *= 16777619u;
+		}
+
+		return id;
+	}
 }
@@ -1,13 +1,17 @@
 #pragma once
 #include "ComponentRegistryBase.h"
+#include "ComponentIndex.hpp"
+#include "Threading.hpp"
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <unordered_map>
+#include <vector>
 
 namespace QPEcs
 {
 	template <typename Component>
-	class ComponentRegistry : public ComponentRegistryBase
+	class ComponentRegistry final : public ComponentRegistryBase
 	{
 		public:
 			ComponentRegistry();
@@ -20,16 +24,64 @@ namespace QPEcs
 
 			void CopyComponent(Entity aFrom, Entity aTo);
 
-			Component& GetComponent(Entity aEntity);
+			// Non-indexed components are handed out mutably, so the component is marked as changed.
+			ComponentReference<Component> GetComponent(Entity aEntity);
+
+			// Indexed components can only be modified through here, so the index is updated afterwards.
+			template <typename Function>
+			void PatchComponent(Entity aEntity, Function&& aFunction);
+
+			// Marks the component as changed this tick, for writes through a reference obtained in an earlier tick.
+			void MarkChanged(Entity aEntity);
+
+			template <typename Key>
+			std::vector<Entity> FindByIndex(const Key& aKey) const;
+
+			template <typename Key>
+			std::vector<Entity> FindByIndexRange(const Key& aMin, const Key& aMax) const;
 
 			virtual void OnEntityDestroyed(Entity aEntity) override;
 
+			virtual void SetTick(uint32_t aTick) override;
+
+			virtual void CaptureComponent(Entity aEntity, ComponentSnapshot& aSnapshot) const override;
+
+			virtual bool WriteComponentDelta(const std::byte* aBaseline, size_t aBaselineSize, const std::byte* aTarget, size_t aTargetSize, ByteWriter& aWriter) const override;
+
+			virtual bool ValidateComponent(DeltaOperation aOperation, ByteReader& aReader) const override;
+
+			virtual void ReadComponent(Entity aEntity, DeltaOperation aOperation, ByteReader& aReader) override;
+
 		private:
 			std::array<Component, MaxEntities> myComponents {};
 			std::unordered_map<Entity, uint32_t> myEntityToIndexMap {};
-			std::unordered_map<uint32_t, Entity> myIndexToEntityMap {};
 
+			// Removed slots are reused instead of filled with the last component, so a component
+			// never moves while it's alive and references to other entities' components stay valid.
+			std::vector<uint32_t> myFreeIndices {};
 			uint32_t mySize {};
+
+			ComponentIndex<Component> myIndex {};
+
+			// The tick each slot was last changed in, so deltas only compare components changed since their baseline.
+			// Atomic since lookups stamp slots under the shared lock.
+			std::array<std::atomic<uint32_t>, MaxEntities> myChangeTicks {};
+			uint32_t myTick {};
+
+			// Adding and removing takes the lock exclusively, lookups share it so
+			// threads may read and write components of distinct entities at once.
+			mutable SharedMutex myMutex {};
+
+			template<typename ... Args>
+			void AddComponentUnlocked(Entity aEntity, Args&&... aArgs);
+
+			void RemoveComponentUnlocked(Entity aEntity);
+
+			uint32_t AcquireIndexUnlocked();
+
+			void MarkChangedUnlocked(uint32_t aIndex);
+
+			static void WriteValue(const Component& aComponent, ByteWriter& aWriter);
 	};
 
 	template <typename Component>
@@ -45,59 +97,355 @@ namespace QPEcs
 	template <typename Component>
 	template <typename ... Args>
 	void ComponentRegistry<Component>::AddComponent(Entity aEntity, Args&&... aArgs)
+	{
+		WriteLock lock(myMutex);
+		AddComponentUnlocked(aEntity, std::forward<Args>(aArgs)...);
+	}
+
+	template <typename Component>
+	template <typename ... Args>
+	void ComponentRegistry<Component>::AddComponentUnlocked(Entity aEntity, Args&&... aArgs)
 	{
 		assert(!myEntityToIndexMap.contains(aEntity) && "Entity already has component");
 
-		uint32_t index = mySize++;
+		uint32_t index = AcquireIndexUnlocked();
 		myEntityToIndexMap[aEntity] = index;
-		myIndexToEntityMap[index] = aEntity;
 		myComponents[index] = Component(std::forward<Args>(aArgs)...);
+		MarkChangedUnlocked(index);
+
+		if constexpr (ComponentIndex<Component>::IsIndexed)
+		{
+			myIndex.Insert(aEntity, myComponents[index]);
+		}
 	}
 
 	template <typename Component>
 	void ComponentRegistry<Component>::RemoveComponent(Entity aEntity)
+	{
+		WriteLock lock(myMutex);
+		RemoveComponentUnlocked(aEntity);
+	}
+
+	template <typename Component>
+	void ComponentRegistry<Component>::RemoveComponentUnlocked(Entity aEntity)
 	{
 		assert(myEntityToIndexMap.contains(aEntity) && "Removing component which doesn't exist!");
 
 		uint32_t removedEntityIndex = myEntityToIndexMap[aEntity];
-		uint32_t lastIndex = --mySize;
-		myComponents[removedEntityIndex] = myComponents[lastIndex];
-
-		Entity lastEntity = myIndexToEntityMap[lastIndex];
-		myEntityToIndexMap[lastEntity] = removedEntityIndex;
-		myIndexToEntityMap[removedEntityIndex] = lastEntity;
+		myComponents[removedEntityIndex] = Component {};
+		myFreeIndices.push_back(removedEntityIndex);
 
 		myEntityToIndexMap.erase(aEntity);
-		myIndexToEntityMap.erase(lastIndex);
+
+		if constexpr (ComponentIndex<Component>::IsIndexed)
+		{
+			myIndex.Erase(aEntity);
+		}
+	}
+
+	template <typename Component>
+	uint32_t ComponentRegistry<Component>::AcquireIndexUnlocked()
+	{
+		if (myFreeIndices.empty())
+		{
+			return mySize++;
+		}
+
+		uint32_t index = myFreeIndices.back();
+		myFreeIndices.pop_back();
+		return index;
 	}
 
 	template <typename Component>
 	void ComponentRegistry<Component>::CopyComponent(Entity aFrom, Entity aTo)
 	{
+		WriteLock lock(myMutex);
 		assert(myEntityToIndexMap.contains(aFrom) && "The entity to copy from doesn't have component");
 		assert(!myEntityToIndexMap.contains(aTo) && "The entity to copy to already has component");
-		Component& componentToCopy = GetComponent(aFrom);
+		Component& componentToCopy = myComponents[myEntityToIndexMap.at(aFrom)];
 
-		uint32_t index = mySize++;
+		uint32_t index = AcquireIndexUnlocked();
 
 		myEntityToIndexMap[aTo] = index;
-		myIndexToEntityMap[index] = aTo;
 		myComponents[index] = Component(componentToCopy);
+		MarkChangedUnlocked(index);
+
+		if constexpr (ComponentIndex<Component>::IsIndexed)
+		{
+			myIndex.Insert(aTo, myComponents[index]);
+		}
+	}
+
+	template <typename Component>
+	ComponentReference<Component> ComponentRegistry<Component>::GetComponent(Entity aEntity)
+	{
+		ReadLock lock(myMutex);
+		assert(myEntityToIndexMap.contains(aEntity) && "Entity does not have component");
+
+		const uint32_t index = myEntityToIndexMap.at(aEntity);
+		if constexpr (!ComponentIndex<Component>::IsIndexed)
+		{
+			MarkChangedUnlocked(index);
+		}
+		return myComponents[index];
+	}
+
+	template <typename Component>
+	template <typename Function>
+	void ComponentRegistry<Component>::PatchComponent(Entity aEntity, Function&& aFunction)
+	{
+		WriteLock lock(myMutex);
+		assert(myEntityToIndexMap.contains(aEntity) && "Entity does not have component");
+
+		const uint32_t index = myEntityToIndexMap.at(aEntity);
+		Component& component = myComponents[index];
+		aFunction(component);
+		MarkChangedUnlocked(index);
+
+		if constexpr (ComponentIndex<Component>::IsIndexed)
+		{
+			myIndex.Update(aEntity, component);
+		}
 	}
 
 	template <typename Component>
-	Component& ComponentRegistry<Component>::GetComponent(Entity aEntity)
+	void ComponentRegistry<Component>::MarkChanged(Entity aEntity)
 	{
+		ReadLock lock(myMutex);
 		assert(myEntityToIndexMap.contains(aEntity) && "Entity does not have component");
-		return myComponents[myEntityToIndexMap[aEntity]];
+		MarkChangedUnlocked(myEntityToIndexMap.at(aEntity));
+	}
+
+	template <typename Component>
+	void ComponentRegistry<Component>::MarkChangedUnlocked(uint32_t aIndex)
+	{
+		// Only store when the tick differs, so repeated lookups within a tick don't keep writing the cache line.
+		if (myChangeTicks[aIndex].load(std::memory_order_relaxed) != myTick)
+		{
+			myChangeTicks[aIndex].store(myTick, std::memory_order_relaxed);
+		}
+	}
+
+	template <typename Component>
+	template <typename Key>
+	std::vector<Entity> ComponentRegistry<Component>::FindByIndex(const Key& aKey) const
+	{
+		static_assert(ComponentIndex<Component>::IsIndexed, "Component doesn't have an index!");
+
+		ReadLock lock(myMutex);
+		return myIndex.Find(aKey);
+	}
+
+	template <typename Component>
+	template <typename Key>
+	std::vector<Entity> ComponentRegistry<Component>::FindByIndexRange(const Key& aMin, const Key& aMax) const
+	{
+		static_assert(ComponentIndex<Component>::IsIndexed, "Component doesn't have an index!");
+
+		ReadLock lock(myMutex);
+		return myIndex.FindRange(aMin, aMax);
 	}
 
 	template <typename Component>
 	void ComponentRegistry<Component>::OnEntityDestroyed(Entity aEntity)
 	{
+		WriteLock lock(myMutex);
 		if (myEntityToIndexMap.contains(aEntity))
 		{
-			RemoveComponent(aEntity);
+			RemoveComponentUnlocked(aEntity);
+		}
+	}
+
+	template <typename Component>
+	void ComponentRegistry<Component>::SetTick(uint32_t aTick)
+	{
+		WriteLock lock(myMutex);
+		myTick = aTick;
+	}
+
+	template <typename Component>
+	void ComponentRegistry<Component>::CaptureComponent(Entity aEntity, ComponentSnapshot& aSnapshot) const
+	{
+		if constexpr (IsReplicatedComponent<Component>)
+		{
+			ReadLock lock(myMutex);
+			assert(myEntityToIndexMap.contains(aEntity) && "Entity does not have component");
+
+			const uint32_t index = myEntityToIndexMap.at(aEntity);
+			ByteWriter writer(aSnapshot.BeginComponent(aEntity, myChangeTicks[index].load(std::memory_order_relaxed)));
+			WriteValue(myComponents[index], writer);
+		}
+	}
+
+	template <typename Component>
+	bool ComponentRegistry<Component>::WriteComponentDelta(const std::byte* aBaseline, size_t aBaselineSize, const std::byte* aTarget, size_t aTargetSize, ByteWriter& aWriter) const
+	{
+		if constexpr (IsReplicatedComponent<Component>)
+		{
+			if constexpr (HasComponentSerializer<Component>)
+			{
+				if (aTargetSize == aBaselineSize && std::memcmp(aTarget, aBaseline, aBaselineSize) == 0)
+				{
+					return false;
+				}
+
+				aWriter.Write(DeltaOperation::Set);
+				aWriter.WriteBytes(aTarget, aTargetSize);
+				return true;
+			}
+			else
+			{
+				assert(aBaselineSize == sizeof(Component) && aTargetSize == sizeof(Component) && "The snapshots don't match the component's size!");
+
+				// A mask with one bit per byte of the component, followed by the bytes that differ.
+				std::array<std::byte, (sizeof(Component) + 7) / 8> mask {};
+				bool hasChanges = false;
+				for (size_t byte = 0; byte < sizeof(Component); byte++)
+				{
+					if (aTarget[byte] != aBaseline[byte])
+					{
+						mask[byte / 8] |= std::byte { 1 } << (byte % 8);
+						hasChanges = true;
+					}
+				}
+
+				if (!hasChanges)
+				{
+					return false;
+				}
+
+				aWriter.Write(DeltaOperation::Patch);
+				aWriter.Write(mask);
+				for (size_t byte = 0; byte < sizeof(Component); byte++)
+				{
+					if ((mask[byte / 8] & (std::byte { 1 } << (byte % 8))) != std::byte { 0 })
+					{
+						aWriter.Write(aTarget[byte]);
+					}
+				}
+				return true;
+			}
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	template <typename Component>
+	bool ComponentRegistry<Component>::ValidateComponent(DeltaOperation aOperation, ByteReader& aReader) const
+	{
+		if constexpr (IsReplicatedComponent<Component>)
+		{
+			if (aOperation == DeltaOperation::Remove)
+			{
+				return true;
+			}
+
+			if constexpr (HasComponentSerializer<Component>)
+			{
+				if (aOperation != DeltaOperation::Set)
+				{
+					return false;
+				}
+
+				Component component {};
+				ComponentSerializer<Component>::Read(component, aReader);
+			}
+			else if (aOperation == DeltaOperation::Set)
+			{
+				aReader.Skip(sizeof(Component));
+			}
+			else
+			{
+				const auto mask = aReader.Read<std::array<std::byte, (sizeof(Component) + 7) / 8>>();
+				size_t changedBytes = 0;
+				for (size_t byte = 0; byte < mask.size() * 8; byte++)
+				{
+					if ((mask[byte / 8] & (std::byte { 1 } << (byte % 8))) != std::byte { 0 })
+					{
+						if (byte >= sizeof(Component))
+						{
+							return false;
+						}
+						changedBytes++;
+					}
+				}
+				aReader.Skip(changedBytes);
+			}
+
+			return !aReader.HasFailed();
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	template <typename Component>
+	void ComponentRegistry<Component>::ReadComponent(Entity aEntity, DeltaOperation aOperation, ByteReader& aReader)
+	{
+		if constexpr (IsReplicatedComponent<Component>)
+		{
+			WriteLock lock(myMutex);
+
+			if (aOperation == DeltaOperation::Remove)
+			{
+				if (myEntityToIndexMap.contains(aEntity))
+				{
+					RemoveComponentUnlocked(aEntity);
+				}
+				return;
+			}
+
+			if (!myEntityToIndexMap.contains(aEntity))
+			{
+				assert(aOperation == DeltaOperation::Set && "Patching a component the entity doesn't have!");
+				AddComponentUnlocked(aEntity);
+			}
+
+			const uint32_t index = myEntityToIndexMap.at(aEntity);
+			Component& component = myComponents[index];
+			if constexpr (HasComponentSerializer<Component>)
+			{
+				ComponentSerializer<Component>::Read(component, aReader);
+			}
+			else if (aOperation == DeltaOperation::Set)
+			{
+				aReader.ReadBytes(&component, sizeof(Component));
+			}
+			else
+			{
+				const auto mask = aReader.Read<std::array<std::byte, (sizeof(Component) + 7) / 8>>();
+				std::byte* bytes = reinterpret_cast<std::byte*>(&component);
+				for (size_t byte = 0; byte < sizeof(Component); byte++)
+				{
+					if ((mask[byte / 8] & (std::byte { 1 } << (byte % 8))) != std::byte { 0 })
+					{
+						bytes[byte] = aReader.Read<std::byte>();
+					}
+				}
+			}
+
+			MarkChangedUnlocked(index);
+
+			if constexpr (ComponentIndex<Component>::IsIndexed)
+			{
+				myIndex.Update(aEntity, component);
+			}
+		}
+	}
+
+	template <typename Component>
+	void ComponentRegistry<Component>::WriteValue(const Component& aComponent, ByteWriter& aWriter)
+	{
+		if constexpr (HasComponentSerializer<Component>)
+		{
+			ComponentSerializer<Component>::Write(aComponent, aWriter);
+		}
+		else if constexpr (std::is_trivially_copyable_v<Component>)
+		{
+			aWriter.WriteBytes(&aComponent, sizeof(Component));
 		}
 	}
 }
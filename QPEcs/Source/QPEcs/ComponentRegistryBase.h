@@ -1,5 +1,6 @@
 #pragma once
 #include "Entity.hpp"
+#include "Snapshot.hpp"
 
 namespace QPEcs
 {
@@ -8,5 +9,18 @@ namespace QPEcs
 		public:
 			virtual ~ComponentRegistryBase() = default;
 			virtual void OnEntityDestroyed(Entity aEntity) = 0;
+
+			// Components changed from here on are stamped with aTick.
+			virtual void SetTick(uint32_t aTick) = 0;
+
+			virtual void CaptureComponent(Entity aEntity, ComponentSnapshot& aSnapshot) const = 0;
+
+			// Writes the operation turning the captured value aBaseline into aTarget, returns false if nothing changed.
+			virtual bool WriteComponentDelta(const std::byte* aBaseline, size_t aBaselineSize, const std::byte* aTarget, size_t aTargetSize, ByteWriter& aWriter) const = 0;
+
+			// Reads past the operation's payload without applying it, returns false if it's malformed.
+			virtual bool ValidateComponent(DeltaOperation aOperation, ByteReader& aReader) const = 0;
+
+			virtual void ReadComponent(Entity aEntity, DeltaOperation aOperation, ByteReader& aReader) = 0;
 	};
 }
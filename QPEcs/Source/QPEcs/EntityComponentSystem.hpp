@@ -3,6 +3,8 @@
 #include "EntityManager.hpp"
 #include "ComponentManager.hpp"
 #include "Views/ViewManager.hpp"
+#include "Threading.hpp"
+#include <bitset>
 #include <functional>
 
 namespace QPEcs
@@ -16,6 +18,7 @@ namespace QPEcs
 		EntityComponentSystem();
 		~EntityComponentSystem() = default;
 
+		// Returns NullEntity when MaxEntities are already alive.
 		inline Entity CreateEntity();
 
 		inline void DestroyEntity(Entity aEntity);
@@ -28,8 +31,9 @@ namespace QPEcs
 		template <class Component>
 		inline bool IsComponentRegistered();
 
+		// Returns a reference to the added component, or nothing for tag components.
 		template <class Component, typename ... Args>
-		inline Component& AddComponent(Entity aEntity, Args&&... aArgs);
+		inline decltype(auto) AddComponent(Entity aEntity, Args&&... aArgs);
 
 		template <class Component>
 		inline void RemoveComponent(Entity aEntity);
@@ -41,26 +45,72 @@ namespace QPEcs
 		inline void TryCopyComponents(Entity aFrom, Entity aTo);
 
 		template <class Component>
-		inline Component& GetComponent(Entity aEntity);
+		inline ComponentReference<Component> GetComponent(Entity aEntity);
 
 		template <class Component, typename ... Args>
-		inline Component& GetOrAddComponent(Entity aEntity, Args&&... aArgs);
+		inline decltype(auto) GetOrAddComponent(Entity aEntity, Args&&... aArgs);
+
+		template <class Component, typename Function>
+		inline void PatchComponent(Entity aEntity, Function&& aFunction);
+
+		// Call after writing through a reference obtained before the last CaptureSnapshot, otherwise the write isn't replicated.
+		template <class Component>
+		inline void MarkChanged(Entity aEntity);
+
+		template <class Component>
+		inline std::vector<Entity> FindByIndex(const typename ComponentIndex<Component>::Key& aKey);
+
+		template <class Component>
+		inline std::vector<Entity> FindByIndexRange(const typename ComponentIndex<Component>::Key& aMin, const typename ComponentIndex<Component>::Key& aMax);
 
 		template <class Component>
 		inline ComponentType GetComponentType();
 
+		// Lazy views are brought up to date here, so hold on to the returned view only while nothing changes.
+		// Views are iterated without a lock, don't get or read one while other threads change signatures.
 		template <class ... Components>
 		inline const View<Components...>& GetView();
 
+		template <class ... Components>
+		inline void SetViewPolicy(ViewPolicy aPolicy);
+
 		inline void ForEach(std::function<void(Entity)> aFunctionToRun) const;
 
+		// Components received in a delta must be registered before it's applied.
+		template <class ... Components>
+		inline void RegisterComponents();
+
+		// Records the replicated state and starts a new tick. Components are stamped with the tick they're added,
+		// copied, patched, received or handed out by GetComponent in, and deltas only compare components stamped
+		// after their baseline. Re-fetch components each tick or use MarkChanged when writing through an older reference.
+		inline Snapshot CaptureSnapshot();
+
+		// Writes the changes from aBaseline to aTarget: destroyed and created entities, added and removed
+		// components and components whose value differs. Capture one snapshot per tick, then write each
+		// receiver's delta from the last snapshot it applied to the new one. Pass an empty snapshot as
+		// aBaseline to send the full state.
+		inline void WriteDelta(const Snapshot& aBaseline, const Snapshot& aTarget, std::vector<std::byte>& aDelta) const;
+
+		// Applies a delta written by another world. Entities keep their ids, so the ids must be free
+		// or already belong to the replicated entity. Returns false without applying anything if the delta's
+		// baseline isn't the target of the last delta applied, a delta against an empty snapshot is always applied.
+		// The delta is checked in full before anything is applied, so malformed or truncated data is rejected too.
+		inline bool ApplyDelta(const std::vector<std::byte>& aDelta);
+
 	private:
 		std::unique_ptr<EntityManager> myEntityManager;
 		std::unique_ptr<ComponentManager> myComponentManager;
 		std::unique_ptr<ViewManager> myViewManager;
+		std::unique_ptr<EntityAccessChecker> myEntityAccessChecker;
+
+		// The target tick of the last delta applied, a delta is only valid on top of the state it was written against.
+		uint32_t myLastAppliedTick {};
 
 		void NotifyViewsOfAllEntities();
 
+		// Reads the rest of a delta without changing anything, returns false if it can't be applied to this world.
+		inline bool ValidateDelta(ByteReader& aReader) const;
+
 		template <class Component>
 		inline void CopyComponent(Entity aFrom, Entity aTo);
 
@@ -80,6 +130,317 @@ namespace QPEcs
 		}
 	}
 
+	template <class ... Components>
+	inline void EntityComponentSystem::RegisterComponents()
+	{
+		((myComponentManager->RegisterComponent<Components>()), ...);
+	}
+
+	inline Snapshot EntityComponentSystem::CaptureSnapshot()
+	{
+		Snapshot snapshot;
+		snapshot.myTick = myComponentManager->GetTick();
+
+		myEntityManager->ForEachEntity([&](Entity aEntity)
+		{
+			const Signature signature = myEntityManager->GetSignature(aEntity);
+			snapshot.myEntities.push_back(aEntity);
+			snapshot.mySignatures.push_back(signature);
+
+			myComponentManager->ForEachReplicatedComponent([&](const ReplicatedComponent& aComponent)
+			{
+				if (aComponent.myRegistry && signature.test(aComponent.myType))
+				{
+					aComponent.myRegistry->CaptureComponent(aEntity, snapshot.myComponents[aComponent.myType]);
+				}
+			});
+		});
+
+		myComponentManager->SetTick(snapshot.myTick + 1);
+
+		return snapshot;
+	}
+
+	inline void EntityComponentSystem::WriteDelta(const Snapshot& aBaseline, const Snapshot& aTarget, std::vector<std::byte>& aDelta) const
+	{
+		assert(aBaseline.myTick < aTarget.myTick && "The baseline must have been captured before the target!");
+
+		aDelta.clear();
+		ByteWriter writer(aDelta);
+
+		writer.Write(aBaseline.myTick);
+		writer.Write(aTarget.myTick);
+
+		const size_t destroyedCountOffset = writer.GetSize();
+		uint32_t destroyedCount = 0;
+		writer.Write(destroyedCount);
+		// Both snapshots list their entities in ascending order, so they're walked side by side instead of searched.
+		size_t targetIndex = 0;
+		for (Entity entity : aBaseline.myEntities)
+		{
+			while (targetIndex < aTarget.myEntities.size() && aTarget.myEntities[targetIndex] < entity)
+			{
+				targetIndex++;
+			}
+
+			if (targetIndex == aTarget.myEntities.size() || aTarget.myEntities[targetIndex] != entity)
+			{
+				writer.Write(entity);
+				destroyedCount++;
+			}
+		}
+		writer.WriteAt(destroyedCountOffset, destroyedCount);
+
+		const size_t changedCountOffset = writer.GetSize();
+		uint32_t changedCount = 0;
+		writer.Write(changedCount);
+		size_t baselineIndex = 0;
+		std::array<size_t, MaxComponents> baselinePositions {};
+		std::array<size_t, MaxComponents> targetPositions {};
+		for (size_t entityIndex = 0; entityIndex < aTarget.myEntities.size(); entityIndex++)
+		{
+			const Entity entity = aTarget.myEntities[entityIndex];
+			while (baselineIndex < aBaseline.myEntities.size() && aBaseline.myEntities[baselineIndex] < entity)
+			{
+				baselineIndex++;
+			}
+
+			const bool isCreated = baselineIndex == aBaseline.myEntities.size() || aBaseline.myEntities[baselineIndex] != entity;
+			const Signature previousSignature = isCreated ? Signature {} : aBaseline.mySignatures[baselineIndex];
+			const Signature signature = aTarget.mySignatures[entityIndex];
+
+			const size_t entityOffset = writer.GetSize();
+			writer.Write(entity);
+			writer.Write(isCreated);
+			const size_t operationCountOffset = writer.GetSize();
+			uint16_t operationCount = 0;
+			writer.Write(operationCount);
+
+			myComponentManager->ForEachReplicatedComponent([&](const ReplicatedComponent& aComponent)
+			{
+				const bool hadComponent = previousSignature.test(aComponent.myType);
+				const bool hasComponent = signature.test(aComponent.myType);
+				if (!hadComponent && !hasComponent)
+				{
+					return;
+				}
+
+				const size_t componentOffset = writer.GetSize();
+				writer.Write(aComponent.myId);
+
+				if (!hasComponent)
+				{
+					writer.Write(DeltaOperation::Remove);
+				}
+				else if (!aComponent.myRegistry)
+				{
+					// Tags only replicate their signature bit.
+					if (hadComponent)
+					{
+						writer.Resize(componentOffset);
+						return;
+					}
+
+					writer.Write(DeltaOperation::Set);
+				}
+				else
+				{
+					const ComponentSnapshot& targetComponents = aTarget.myComponents[aComponent.myType];
+					size_t& targetPosition = targetPositions[aComponent.myType];
+					[[maybe_unused]] const bool isCaptured = targetComponents.Seek(entity, targetPosition);
+					assert(isCaptured && "The target is missing a component its signature says it has!");
+
+					size_t targetSize = 0;
+					const std::byte* target = targetComponents.GetData(targetPosition, targetSize);
+
+					if (!hadComponent)
+					{
+						writer.Write(DeltaOperation::Set);
+						writer.WriteBytes(target, targetSize);
+					}
+					else if (targetComponents.GetChangeTick(targetPosition) <= aBaseline.myTick)
+					{
+						// Not changed after the baseline was captured, so it can't differ from it.
+						writer.Resize(componentOffset);
+						return;
+					}
+					else
+					{
+						const ComponentSnapshot& baselineComponents = aBaseline.myComponents[aComponent.myType];
+						size_t& baselinePosition = baselinePositions[aComponent.myType];
+						[[maybe_unused]] const bool wasCaptured = baselineComponents.Seek(entity, baselinePosition);
+						assert(wasCaptured && "The baseline is missing a component its signature says it has!");
+
+						size_t baselineSize = 0;
+						const std::byte* baseline = baselineComponents.GetData(baselinePosition, baselineSize);
+						if (!aComponent.myRegistry->WriteComponentDelta(baseline, baselineSize, target, targetSize, writer))
+						{
+							writer.Resize(componentOffset);
+							return;
+						}
+					}
+				}
+
+				operationCount++;
+			});
+
+			if (!isCreated && operationCount == 0)
+			{
+				writer.Resize(entityOffset);
+				continue;
+			}
+
+			writer.WriteAt(operationCountOffset, operationCount);
+			changedCount++;
+		}
+		writer.WriteAt(changedCountOffset, changedCount);
+	}
+
+	inline bool EntityComponentSystem::ApplyDelta(const std::vector<std::byte>& aDelta)
+	{
+		ByteReader reader(aDelta.data(), aDelta.size());
+
+		const auto baselineTick = reader.Read<uint32_t>();
+		const auto tick = reader.Read<uint32_t>();
+		if (reader.HasFailed() || (baselineTick != 0 && baselineTick != myLastAppliedTick))
+		{
+			return false;
+		}
+
+		ByteReader validationReader = reader;
+		if (!ValidateDelta(validationReader))
+		{
+			return false;
+		}
+
+		const auto destroyedCount = reader.Read<uint32_t>();
+		for (uint32_t i = 0; i < destroyedCount; i++)
+		{
+			const auto entity = reader.Read<Entity>();
+			if (IsValidEntity(entity))
+			{
+				DestroyEntity(entity);
+			}
+		}
+
+		const auto changedCount = reader.Read<uint32_t>();
+		for (uint32_t i = 0; i < changedCount; i++)
+		{
+			const auto entity = reader.Read<Entity>();
+			[[maybe_unused]] const auto isCreated = reader.Read<bool>();
+			const auto operationCount = reader.Read<uint16_t>();
+
+			if (!IsValidEntity(entity))
+			{
+				[[maybe_unused]] const bool wasCreated = myEntityManager->TryCreateEntity(entity);
+				assert(wasCreated && "The replicated entity's id is already in use!");
+			}
+
+			EntityAccessChecker::Scope accessScope(*myEntityAccessChecker, entity);
+			const Signature previousSignature = myEntityManager->GetSignature(entity);
+			Signature signature = previousSignature;
+			for (uint16_t operation = 0; operation < operationCount; operation++)
+			{
+				const auto componentId = reader.Read<ComponentId>();
+				const auto deltaOperation = reader.Read<DeltaOperation>();
+
+				const ReplicatedComponent* component = myComponentManager->FindReplicatedComponent(componentId);
+				assert(component && "Component received in delta hasn't been registered!");
+
+				if (component->myRegistry)
+				{
+					component->myRegistry->ReadComponent(entity, deltaOperation, reader);
+				}
+				signature.set(component->myType, deltaOperation != DeltaOperation::Remove);
+			}
+
+			myEntityManager->SetSignature(entity, signature);
+			myViewManager->OnEntitySignatureChanged(entity, signature, previousSignature ^ signature);
+		}
+
+		assert(reader.IsAtEnd() && "The delta contains more data than was read!");
+
+		myLastAppliedTick = tick;
+		return true;
+	}
+
+	inline bool EntityComponentSystem::ValidateDelta(ByteReader& aReader) const
+	{
+		std::bitset<MaxEntities> isDestroyed {};
+		uint32_t aliveCount = myEntityManager->myEntitiesCount.load(std::memory_order_relaxed);
+
+		const auto destroyedCount = aReader.Read<uint32_t>();
+		for (uint32_t i = 0; i < destroyedCount && !aReader.HasFailed(); i++)
+		{
+			const auto entity = aReader.Read<Entity>();
+			if (entity >= MaxEntities)
+			{
+				return false;
+			}
+
+			if (IsValidEntity(entity) && !isDestroyed.test(entity))
+			{
+				isDestroyed.set(entity);
+				aliveCount--;
+			}
+		}
+
+		std::bitset<MaxEntities> isListed {};
+		const auto changedCount = aReader.Read<uint32_t>();
+		for (uint32_t i = 0; i < changedCount && !aReader.HasFailed(); i++)
+		{
+			const auto entity = aReader.Read<Entity>();
+			const auto isCreated = aReader.Read<uint8_t>();
+			const auto operationCount = aReader.Read<uint16_t>();
+			if (entity >= MaxEntities || isListed.test(entity) || isCreated > 1)
+			{
+				return false;
+			}
+			isListed.set(entity);
+
+			const bool exists = IsValidEntity(entity) && !isDestroyed.test(entity);
+			if (!exists && ++aliveCount > MaxEntities)
+			{
+				return false;
+			}
+
+			Signature signature = exists ? myEntityManager->GetSignature(entity) : Signature {};
+			for (uint16_t operation = 0; operation < operationCount && !aReader.HasFailed(); operation++)
+			{
+				const auto componentId = aReader.Read<ComponentId>();
+				const auto deltaOperation = aReader.Read<DeltaOperation>();
+
+				const ReplicatedComponent* component = myComponentManager->FindReplicatedComponent(componentId);
+				if (!component || deltaOperation > DeltaOperation::Patch)
+				{
+					return false;
+				}
+
+				// Patches are only valid on top of a component the entity already has.
+				if (deltaOperation == DeltaOperation::Patch && !signature.test(component->myType))
+				{
+					return false;
+				}
+
+				if (component->myRegistry)
+				{
+					if (!component->myRegistry->ValidateComponent(deltaOperation, aReader))
+					{
+						return false;
+					}
+				}
+				else if (deltaOperation == DeltaOperation::Patch)
+				{
+					return false;
+				}
+
+				signature.set(component->myType, deltaOperation != DeltaOperation::Remove);
+			}
+		}
+
+		return !aReader.HasFailed() && aReader.IsAtEnd();
+	}
+
 	inline bool EntityComponentSystem::IsValidEntity(Entity aEntity) const
 	{
 		return myEntityManager->IsValid(aEntity);
@@ -100,37 +461,54 @@ namespace QPEcs
 	}
 
 	template <class Component, typename ... Args>
-	inline Component& EntityComponentSystem::AddComponent(Entity aEntity, Args&&... aArgs)
+	inline decltype(auto) EntityComponentSystem::AddComponent(Entity aEntity, Args&&... aArgs)
 	{
+		EntityAccessChecker::Scope accessScope(*myEntityAccessChecker, aEntity);
+
 		if (!myComponentManager->IsRegistered<Component>())
 		{
 			myComponentManager->RegisterComponent<Component>();
 		}
 
-		myComponentManager->AddComponent<Component>(aEntity, std::forward<Args>(aArgs)...);
+		if constexpr (IsTagComponent<Component>)
+		{
+			assert(!HasComponent<Component>(aEntity) && "Entity already has component");
+		}
+		else
+		{
+			myComponentManager->AddComponent<Component>(aEntity, std::forward<Args>(aArgs)...);
+		}
 
 		auto signature = myEntityManager->GetSignature(aEntity);
 		signature.set(myComponentManager->GetComponentType<Component>());
 		myEntityManager->SetSignature(aEntity, signature);
 
-		myViewManager->OnEntitySignatureChanged(aEntity, signature);
+		myViewManager->OnEntitySignatureChanged(aEntity, signature, myComponentManager->GetComponentType<Component>());
 
-		return myComponentManager->GetComponent<Component>(aEntity);
+		if constexpr (!IsTagComponent<Component>)
+		{
+			return myComponentManager->GetComponent<Component>(aEntity);
+		}
 	}
 
 	template <class Component>
 	inline void EntityComponentSystem::RemoveComponent(Entity aEntity)
 	{
+		// Claim the entity before checking, so a conflicting change can't slip in between the check and the removal.
+		EntityAccessChecker::Scope accessScope(*myEntityAccessChecker, aEntity);
 		if (myComponentManager->IsRegistered<Component>() 
 			&& HasComponent<Component>(aEntity))
 		{
-			myComponentManager->RemoveComponent<Component>(aEntity);
+			if constexpr (!IsTagComponent<Component>)
+			{
+				myComponentManager->RemoveComponent<Component>(aEntity);
+			}
 
 			auto signature = myEntityManager->GetSignature(aEntity);
 			signature.reset(myComponentManager->GetComponentType<Component>());
 			myEntityManager->SetSignature(aEntity, signature);
 
-			myViewManager->OnEntitySignatureChanged(aEntity, signature);
+			myViewManager->OnEntitySignatureChanged(aEntity, signature, myComponentManager->GetComponentType<Component>());
 		}
 	}
 
@@ -139,13 +517,18 @@ namespace QPEcs
 	{
 		if (myComponentManager->IsRegistered<Component>())
 		{
-			myComponentManager->CopyComponent<Component>(aFrom, aTo);
+			EntityAccessChecker::Scope fromAccessScope(*myEntityAccessChecker, aFrom);
+			EntityAccessChecker::Scope toAccessScope(*myEntityAccessChecker, aTo);
+			if constexpr (!IsTagComponent<Component>)
+			{
+				myComponentManager->CopyComponent<Component>(aFrom, aTo);
+			}
 
 			auto signature = myEntityManager->GetSignature(aTo);
 			signature.set(myComponentManager->GetComponentType<Component>());
 			myEntityManager->SetSignature(aTo, signature);
 
-			myViewManager->OnEntitySignatureChanged(aTo, signature);
+			myViewManager->OnEntitySignatureChanged(aTo, signature, myComponentManager->GetComponentType<Component>());
 		}
 	}
 
@@ -158,6 +541,8 @@ namespace QPEcs
 	template <class Component>
 	void EntityComponentSystem::TryCopyComponent(Entity aFrom, Entity aTo)
 	{
+		EntityAccessChecker::Scope fromAccessScope(*myEntityAccessChecker, aFrom);
+		EntityAccessChecker::Scope toAccessScope(*myEntityAccessChecker, aTo);
 		if(!HasComponent<Component>(aFrom))
 		{
 			return;
@@ -173,20 +558,68 @@ namespace QPEcs
 	}
 
 	template <class Component>
-	inline Component& EntityComponentSystem::GetComponent(Entity aEntity)
+	inline ComponentReference<Component> EntityComponentSystem::GetComponent(Entity aEntity)
 	{
+		static_assert(!IsTagComponent<Component>, "Tag components carry no data, use HasComponent instead!");
 		return myComponentManager->GetComponent<Component>(aEntity);
 	}
 
 	template <class Component, typename ... Args>
-	inline Component& EntityComponentSystem::GetOrAddComponent(Entity aEntity, Args&&... aArgs)
+	inline decltype(auto) EntityComponentSystem::GetOrAddComponent(Entity aEntity, Args&&... aArgs)
 	{
-		if(!HasComponent<Component>(aEntity))
+		EntityAccessChecker::Scope accessScope(*myEntityAccessChecker, aEntity);
+		if constexpr (IsTagComponent<Component>)
 		{
-			return AddComponent<Component>(aEntity, std::forward<Args>(aArgs)...);
+			if(!HasComponent<Component>(aEntity))
+			{
+				AddComponent<Component>(aEntity, std::forward<Args>(aArgs)...);
+			}
 		}
+		else
+		{
+			if(!HasComponent<Component>(aEntity))
+			{
+				return AddComponent<Component>(aEntity, std::forward<Args>(aArgs)...);
+			}
 
-		return GetComponent<Component>(aEntity);
+			return GetComponent<Component>(aEntity);
+		}
+	}
+
+	template <class Component, typename Function>
+	inline void EntityComponentSystem::PatchComponent(Entity aEntity, Function&& aFunction)
+	{
+		EntityAccessChecker::Scope accessScope(*myEntityAccessChecker, aEntity);
+		myComponentManager->PatchComponent<Component>(aEntity, std::forward<Function>(aFunction));
+	}
+
+	template <class Component>
+	inline void EntityComponentSystem::MarkChanged(Entity aEntity)
+	{
+		static_assert(!IsTagComponent<Component>, "Tag components carry no data, there's nothing to mark!");
+		myComponentManager->MarkChanged<Component>(aEntity);
+	}
+
+	template <class Component>
+	inline std::vector<Entity> EntityComponentSystem::FindByIndex(const typename ComponentIndex<Component>::Key& aKey)
+	{
+		if (!myComponentManager->IsRegistered<Component>())
+		{
+			return {};
+		}
+
+		return myComponentManager->FindByIndex<Component>(aKey);
+	}
+
+	template <class Component>
+	inline std::vector<Entity> EntityComponentSystem::FindByIndexRange(const typename ComponentIndex<Component>::Key& aMin, const typename ComponentIndex<Component>::Key& aMax)
+	{
+		if (!myComponentManager->IsRegistered<Component>())
+		{
+			return {};
+		}
+
+		return myComponentManager->FindByIndexRange<Component>(aMin, aMax);
 	}
 
 	template <class Component>
@@ -206,11 +639,19 @@ namespace QPEcs
 		return *myViewManager->GetView<Components...>();
 	}
 
+	template <class ... Components>
+	void EntityComponentSystem::SetViewPolicy(ViewPolicy aPolicy)
+	{
+		GetView<Components...>();
+		myViewManager->SetViewPolicy<Components...>(aPolicy);
+	}
+
 	inline EntityComponentSystem::EntityComponentSystem()
 	{
 		myComponentManager = std::make_unique<ComponentManager>();
 		myEntityManager = std::make_unique<EntityManager>();
-		myViewManager = std::make_unique<ViewManager>(myComponentManager.get());
+		myViewManager = std::make_unique<ViewManager>(myComponentManager.get(), myEntityManager.get());
+		myEntityAccessChecker = std::make_unique<EntityAccessChecker>();
 	}
 
 	inline Entity EntityComponentSystem::CreateEntity()
@@ -220,18 +661,20 @@ namespace QPEcs
 
 	inline void EntityComponentSystem::DestroyEntity(Entity aEntity)
 	{
-		myEntityManager->DestroyEntity(aEntity);
+		EntityAccessChecker::Scope accessScope(*myEntityAccessChecker, aEntity);
+		// Release the id last so a concurrent CreateEntity can't reuse it before its components are gone.
 		myComponentManager->OnEntityDestroyed(aEntity);
 		myViewManager->OnEntityDestroyed(aEntity);
+		myEntityManager->DestroyEntity(aEntity);
 	}
 
 	inline void EntityComponentSystem::NotifyViewsOfAllEntities()
 	{
 		for (EntityType entity = 0; entity < MaxEntities; entity++)
 		{
-			if (myEntityManager->myEntities[entity])
+			if (myEntityManager->IsValid(entity))
 			{
-				myViewManager->OnEntitySignatureChanged(entity, myEntityManager->GetSignature(entity));
+				myViewManager->OnEntitySignatureChanged(entity, myEntityManager->GetSignature(entity), Signature {}.set());
 			}
 		}
 	}
@@ -1,89 +1,177 @@
 #pragma once
 #include "Entity.hpp"
 #include "Component.h"
-#include <queue>
 #include <array>
+#include <atomic>
+#include <bit>
 #include <cassert>
 
 namespace QPEcs
 {
-	class EntityManager
+	template <class SignatureType>
+	class BasicEntityManager
 	{
 		friend class EntityComponentSystem;
 		public:
-			EntityManager();
-			~EntityManager() = default;
+			BasicEntityManager();
+			~BasicEntityManager() = default;
 
+			// Returns NullEntity when MaxEntities are already alive.
 			Entity CreateEntity();
 
+			// Claims a specific id, returns false if it's already in use.
+			bool TryCreateEntity(Entity aEntity);
+
 			void DestroyEntity(Entity aEntity);
 
-			void SetSignature(Entity aEntity, Signature aSignature);
+			void SetSignature(Entity aEntity, SignatureType aSignature);
 
-			Signature GetSignature(Entity aEntity) const;
+			SignatureType GetSignature(Entity aEntity) const;
 
 			bool IsValid(Entity aEntity) const;
-			
+
+			template <class Function>
+			void ForEachEntity(Function&& aFunction) const;
+
 		private:
-			std::bitset<MaxEntities> myEntities {};
-			std::array<Signature, MaxEntities> mySignatures {};
-			uint32_t myEntitiesCount {};
-			
+			using EntityWord = uint64_t;
+			static constexpr EntityType EntitiesPerWord = 64;
+			static_assert(MaxEntities % EntitiesPerWord == 0, "MaxEntities must be a multiple of 64!");
+
+			// Entities are reserved by atomically claiming a free bit so CreateEntity never needs a lock.
+			std::array<std::atomic<EntityWord>, MaxEntities / EntitiesPerWord> myEntities {};
+			std::array<SignatureType, MaxEntities> mySignatures {};
+			std::atomic<uint32_t> myEntitiesCount {};
+
+			bool TryReserveEntity();
+
 	};
 
-	inline bool EntityManager::IsValid(Entity aEntity) const
+	using EntityManager = BasicEntityManager<Signature>;
+
+	template <class SignatureType>
+	inline bool BasicEntityManager<SignatureType>::IsValid(Entity aEntity) const
 	{
 		if(aEntity >= MaxEntities)
 		{
 			return false;
 		}
 
-		return myEntities[aEntity];
+		return (myEntities[aEntity / EntitiesPerWord].load(std::memory_order_acquire) >> (aEntity % EntitiesPerWord)) & 1;
 	}
 
+	template <class SignatureType>
+	template <class Function>
+	void BasicEntityManager<SignatureType>::ForEachEntity(Function&& aFunction) const
+	{
+		for (EntityType wordIndex = 0; wordIndex < myEntities.size(); wordIndex++)
+		{
+			EntityWord word = myEntities[wordIndex].load(std::memory_order_acquire);
+			while (word != 0)
+			{
+				const EntityType bit = std::countr_zero(word);
+				word &= word - 1;
 
-	inline EntityManager::EntityManager()
+				aFunction(static_cast<Entity>(wordIndex * EntitiesPerWord + bit));
+			}
+		}
+	}
+
+	template <class SignatureType>
+	inline BasicEntityManager<SignatureType>::BasicEntityManager()
 	{
 	}
 
-	inline Entity EntityManager::CreateEntity()
+	template <class SignatureType>
+	inline Entity BasicEntityManager<SignatureType>::CreateEntity()
 	{
-		assert(myEntitiesCount < MaxEntities && "Number of entities exceeding max entities!");
+		if (!TryReserveEntity())
+		{
+			return NullEntity;
+		}
 
-		Entity entity = 0;
-		for (EntityType nextEntity = 0; nextEntity < MaxEntities; nextEntity++)
+		// The reservation above guarantees a free bit exists, but other threads may claim it first so keep scanning until we win one.
+		while (true)
 		{
-			if(!myEntities[nextEntity])
+			for (EntityType wordIndex = 0; wordIndex < myEntities.size(); wordIndex++)
 			{
-				entity = nextEntity;
-				break;
+				EntityWord word = myEntities[wordIndex].load(std::memory_order_relaxed);
+				while (word != ~EntityWord {})
+				{
+					const EntityType bit = std::countr_one(word);
+					if (myEntities[wordIndex].compare_exchange_weak(word, word | (EntityWord { 1 } << bit), std::memory_order_acq_rel))
+					{
+						return wordIndex * EntitiesPerWord + bit;
+					}
+				}
 			}
 		}
+	}
+
+	template <class SignatureType>
+	inline bool BasicEntityManager<SignatureType>::TryCreateEntity(Entity aEntity)
+	{
+		assert(aEntity < MaxEntities && "Attempting to create entity out of range!");
+
+		if (!TryReserveEntity())
+		{
+			return false;
+		}
 
-		myEntities.set(entity);
-		myEntitiesCount++;
+		const EntityWord bit = EntityWord { 1 } << (aEntity % EntitiesPerWord);
+		if (myEntities[aEntity / EntitiesPerWord].fetch_or(bit, std::memory_order_acq_rel) & bit)
+		{
+			myEntitiesCount.fetch_sub(1, std::memory_order_relaxed);
+			return false;
+		}
 
-		return entity;
+		return true;
 	}
 
-	inline void EntityManager::DestroyEntity(Entity aEntity)
+	template <class SignatureType>
+	inline bool BasicEntityManager<SignatureType>::TryReserveEntity()
+	{
+		// The count is raised before a bit is claimed and lowered after it's released,
+		// so it never drops below the number of claimed bits.
+		if (myEntitiesCount.fetch_add(1, std::memory_order_relaxed) >= MaxEntities)
+		{
+			myEntitiesCount.fetch_sub(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		return true;
+	}
+
+	template <class SignatureType>
+	inline void BasicEntityManager<SignatureType>::DestroyEntity(Entity aEntity)
 	{
 		assert(aEntity < MaxEntities && "Attempting to destroy entity out of range!");
 
-		myEntities.reset(aEntity);
+		// Destroying an id that isn't alive must leave the count alone, or it wraps and no entity can be created again.
+		if (!IsValid(aEntity))
+		{
+			return;
+		}
+
 		mySignatures[aEntity].reset();
 
-		myEntitiesCount--;
+		const EntityWord bit = EntityWord { 1 } << (aEntity % EntitiesPerWord);
+		if (myEntities[aEntity / EntitiesPerWord].fetch_and(~bit, std::memory_order_release) & bit)
+		{
+			myEntitiesCount.fetch_sub(1, std::memory_order_relaxed);
+		}
 	}
 
-	inline void EntityManager::SetSignature(Entity aEntity, Signature aSignature)
+	template <class SignatureType>
+	inline void BasicEntityManager<SignatureType>::SetSignature(Entity aEntity, SignatureType aSignature)
 	{
 		assert(aEntity < MaxEntities && "Attempting to set signature for an entity out of range!");
 
 		mySignatures[aEntity] = aSignature;
 	}
 
-	inline Signature EntityManager::GetSignature(Entity aEntity) const
+	template <class SignatureType>
+	inline SignatureType BasicEntityManager<SignatureType>::GetSignature(Entity aEntity) const
 	{
 		assert(aEntity < MaxEntities && "Attempting to get signature for an entity out of range!");
 
@@ -0,0 +1,257 @@
+#pragma once
+#include "Entity.hpp"
+#include "Component.h"
+#include "Types.h"
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace QPEcs
+{
+	class ByteWriter
+	{
+		public:
+			explicit ByteWriter(std::vector<std::byte>& aBuffer);
+
+			template <class Value>
+			void Write(const Value& aValue);
+
+			template <class Value>
+			void WriteAt(size_t aOffset, const Value& aValue);
+
+			void WriteBytes(const void* aData, size_t aSize);
+
+			size_t GetSize() const;
+
+			void Resize(size_t aSize);
+
+		private:
+			std::vector<std::byte>& myBuffer;
+	};
+
+	// Reading past the end doesn't touch memory outside the buffer, it zeroes the output and sets HasFailed,
+	// so data received from the network can be read first and checked afterwards.
+	class ByteReader
+	{
+		public:
+			ByteReader(const std::byte* aData, size_t aSize);
+
+			template <class Value>
+			Value Read();
+
+			void ReadBytes(void* aData, size_t aSize);
+
+			void Skip(size_t aSize);
+
+			bool IsAtEnd() const;
+
+			bool HasFailed() const;
+
+		private:
+			const std::byte* myData { nullptr };
+			size_t mySize {};
+			size_t myPosition {};
+			bool myHasFailed { false };
+	};
+
+	// Specialize for components that aren't trivially copyable to have them replicated:
+	// template <> struct QPEcs::ComponentSerializer<Name>
+	// {
+	//     static void Write(const Name& aName, QPEcs::ByteWriter& aWriter);
+	//     static void Read(Name& aName, QPEcs::ByteReader& aReader);
+	// };
+	// Read also runs on data received from the network before it's applied, so check lengths before allocating for them.
+	template <class Component>
+	struct ComponentSerializer
+	{
+	};
+
+	template <class Component>
+	concept HasComponentSerializer = requires(const Component& aComponent, Component& aResult, ByteWriter& aWriter, ByteReader& aReader)
+	{
+		ComponentSerializer<Component>::Write(aComponent, aWriter);
+		ComponentSerializer<Component>::Read(aResult, aReader);
+	};
+
+	// Components with a serializer are sent whole when they change, other trivially copyable
+	// components are diffed byte by byte and tags only replicate their signature bit.
+	template <class Component>
+	constexpr bool IsReplicatedComponent = IsTagComponent<Component> || HasComponentSerializer<Component> || std::is_trivially_copyable_v<Component>;
+
+	enum class DeltaOperation : uint8_t
+	{
+		Remove,
+		Set,
+		Patch
+	};
+
+	// The serialized value of one component type for every entity that had it.
+	class ComponentSnapshot
+	{
+		public:
+			std::vector<std::byte>& BeginComponent(Entity aEntity, uint32_t aChangeTick);
+
+			// Moves aPosition forward to aEntity and returns whether it was captured. Entities must be
+			// sought in ascending order starting from position 0, so a whole pass is linear.
+			bool Seek(Entity aEntity, size_t& aPosition) const;
+
+			const std::byte* GetData(size_t aPosition, size_t& aSize) const;
+
+			// The tick the component was last changed in before it was captured.
+			uint32_t GetChangeTick(size_t aPosition) const;
+
+		private:
+			// Entities are captured in ascending order so they can be binary searched.
+			std::vector<Entity> myEntities {};
+			std::vector<size_t> myOffsets {};
+			std::vector<uint32_t> myChangeTicks {};
+			std::vector<std::byte> myData {};
+	};
+
+	// The replicated state of an EntityComponentSystem at a tick, used as the baseline for deltas.
+	// A default constructed snapshot is empty, so a delta against it contains the full state.
+	class Snapshot
+	{
+		friend class EntityComponentSystem;
+		public:
+			uint32_t GetTick() const;
+
+		private:
+			uint32_t myTick {};
+			std::vector<Entity> myEntities {};
+			std::vector<Signature> mySignatures {};
+			std::array<ComponentSnapshot, MaxComponents> myComponents {};
+	};
+
+	inline ByteWriter::ByteWriter(std::vector<std::byte>& aBuffer)
+		: myBuffer(aBuffer)
+	{
+	}
+
+	template <class Value>
+	void ByteWriter::Write(const Value& aValue)
+	{
+		static_assert(std::is_trivially_copyable_v<Value>, "Only trivially copyable values can be written directly!");
+		WriteBytes(&aValue, sizeof(Value));
+	}
+
+	template <class Value>
+	void ByteWriter::WriteAt(size_t aOffset, const Value& aValue)
+	{
+		static_assert(std::is_trivially_copyable_v<Value>, "Only trivially copyable values can be written directly!");
+		assert(aOffset + sizeof(Value) <= myBuffer.size() && "Writing past the end of the buffer!");
+		std::memcpy(myBuffer.data() + aOffset, &aValue, sizeof(Value));
+	}
+
+	inline void ByteWriter::WriteBytes(const void* aData, size_t aSize)
+	{
+		const size_t offset = myBuffer.size();
+		myBuffer.resize(offset + aSize);
+		std::memcpy(myBuffer.data() + offset, aData, aSize);
+	}
+
+	inline size_t ByteWriter::GetSize() const
+	{
+		return myBuffer.size();
+	}
+
+	inline void ByteWriter::Resize(size_t aSize)
+	{
+		myBuffer.resize(aSize);
+	}
+
+	inline ByteReader::ByteReader(const std::byte* aData, size_t aSize)
+		: myData(aData)
+		, mySize(aSize)
+	{
+	}
+
+	template <class Value>
+	Value ByteReader::Read()
+	{
+		static_assert(std::is_trivially_copyable_v<Value>, "Only trivially copyable values can be read directly!");
+		Value value;
+		ReadBytes(&value, sizeof(Value));
+		return value;
+	}
+
+	inline void ByteReader::ReadBytes(void* aData, size_t aSize)
+	{
+		if (aSize > mySize - myPosition)
+		{
+			std::memset(aData, 0, aSize);
+			myPosition = mySize;
+			myHasFailed = true;
+			return;
+		}
+
+		std::memcpy(aData, myData + myPosition, aSize);
+		myPosition += aSize;
+	}
+
+	inline void ByteReader::Skip(size_t aSize)
+	{
+		if (aSize > mySize - myPosition)
+		{
+			myPosition = mySize;
+			myHasFailed = true;
+			return;
+		}
+
+		myPosition += aSize;
+	}
+
+	inline bool ByteReader::IsAtEnd() const
+	{
+		return myPosition == mySize;
+	}
+
+	inline bool ByteReader::HasFailed() const
+	{
+		return myHasFailed;
+	}
+
+	inline std::vector<std::byte>& ComponentSnapshot::BeginComponent(Entity aEntity, uint32_t aChangeTick)
+	{
+		assert((myEntities.empty() || myEntities.back() < aEntity) && "Components must be captured in entity order!");
+
+		myEntities.push_back(aEntity);
+		myOffsets.push_back(myData.size());
+		myChangeTicks.push_back(aChangeTick);
+		return myData;
+	}
+
+	inline bool ComponentSnapshot::Seek(Entity aEntity, size_t& aPosition) const
+	{
+		while (aPosition < myEntities.size() && myEntities[aPosition] < aEntity)
+		{
+			aPosition++;
+		}
+
+		return aPosition < myEntities.size() && myEntities[aPosition] == aEntity;
+	}
+
+	inline const std::byte* ComponentSnapshot::GetData(size_t aPosition, size_t& aSize) const
+	{
+		assert(aPosition < myEntities.size() && "Position out of range!");
+
+		const size_t end = aPosition + 1 < myOffsets.size() ? myOffsets[aPosition + 1] : myData.size();
+		aSize = end - myOffsets[aPosition];
+		return myData.data() + myOffsets[aPosition];
+	}
+
+	inline uint32_t ComponentSnapshot::GetChangeTick(size_t aPosition) const
+	{
+		assert(aPosition < myEntities.size() && "Position out of range!");
+
+		return myChangeTicks[aPosition];
+	}
+
+	inline uint32_t Snapshot::GetTick() const
+	{
+		return myTick;
+	}
+}
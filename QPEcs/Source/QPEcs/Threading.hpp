@@ -0,0 +1,100 @@
+#pragma once
+#include "Entity.hpp"
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <mutex>
+#include <shared_mutex>
+
+// Define QPE_ECS_THREAD_SAFE before including QPEcs to let worker threads create entities
+// and access components concurrently. Without it every lock below compiles away.
+// Views aren't covered: their entity sets are iterated without a lock, so a view must not be
+// read while other threads add or remove components or destroy entities.
+namespace QPEcs
+{
+#ifdef QPE_ECS_THREAD_SAFE
+	using SharedMutex = std::shared_mutex;
+#else
+	class SharedMutex
+	{
+		public:
+			void lock() {}
+			bool try_lock() { return true; }
+			void unlock() {}
+			void lock_shared() {}
+			bool try_lock_shared() { return true; }
+			void unlock_shared() {}
+	};
+#endif
+
+	using ReadLock = std::shared_lock<SharedMutex>;
+	using WriteLock = std::unique_lock<SharedMutex>;
+
+#if defined(QPE_ECS_THREAD_SAFE) && defined(QPE_DEBUG)
+	// Asserts when two threads change the same entity at the same time.
+	class EntityAccessChecker
+	{
+		public:
+			class Scope
+			{
+				public:
+					Scope(EntityAccessChecker& aChecker, Entity aEntity);
+					~Scope();
+
+					Scope(const Scope&) = delete;
+					Scope& operator=(const Scope&) = delete;
+
+				private:
+					EntityAccessChecker& myChecker;
+					Entity myEntity { NullEntity };
+			};
+
+		private:
+			std::array<std::atomic<uint32_t>, MaxEntities> myOwners {};
+
+			static uint32_t GetThreadTag();
+	};
+
+	inline EntityAccessChecker::Scope::Scope(EntityAccessChecker& aChecker, Entity aEntity)
+		: myChecker(aChecker)
+	{
+		assert(aEntity < MaxEntities && "Attempting to access entity out of range!");
+
+		uint32_t expected = 0;
+		const uint32_t threadTag = GetThreadTag();
+		if (myChecker.myOwners[aEntity].compare_exchange_strong(expected, threadTag, std::memory_order_acquire))
+		{
+			myEntity = aEntity;
+		}
+		else
+		{
+			assert(expected == threadTag && "Conflicting access: entity is being changed by another thread!");
+		}
+	}
+
+	inline EntityAccessChecker::Scope::~Scope()
+	{
+		if (myEntity != NullEntity)
+		{
+			myChecker.myOwners[myEntity].store(0, std::memory_order_release);
+		}
+	}
+
+	inline uint32_t EntityAccessChecker::GetThreadTag()
+	{
+		static std::atomic<uint32_t> nextTag { 1 };
+		thread_local const uint32_t threadTag = nextTag.fetch_add(1, std::memory_order_relaxed);
+		return threadTag;
+	}
+#else
+	class EntityAccessChecker
+	{
+		public:
+			class Scope
+			{
+				public:
+					Scope(EntityAccessChecker&, Entity) {}
+			};
+	};
+#endif
+}
@@ -5,4 +5,5 @@ namespace QPEcs
 {
 	using EntityType = uint32_t;
 	using ComponentType = uint8_t;
+	using ComponentId = uint32_t;
 }
\ No newline at end of file
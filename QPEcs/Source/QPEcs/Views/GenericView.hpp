@@ -1,11 +1,21 @@
 #pragma once
 #include "QPEcs/Entity.hpp"
+#include <bitset>
 #include <unordered_set>
+#include <vector>
 
 namespace QPEcs
 {
 	class EntityComponentSystem;
 
+	enum class ViewPolicy
+	{
+		// Membership is updated on every signature change.
+		Eager,
+		// Changed entities are only recorded and membership is patched on the next GetView.
+		Lazy
+	};
+
 	class GenericView
 	{
 		friend class ViewManager;
@@ -19,6 +29,10 @@ namespace QPEcs
 		protected:
 			std::unordered_set<Entity> myEntities {};
 			EntityComponentSystem* myECS { nullptr };
+
+			ViewPolicy myPolicy { ViewPolicy::Eager };
+			std::bitset<MaxEntities> myIsPending {};
+			std::vector<Entity> myPendingEntities {};
 	};
 
 	inline std::unordered_set<Entity>::iterator GenericView::begin()
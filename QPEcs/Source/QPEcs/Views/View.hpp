@@ -6,37 +6,71 @@
 
 namespace QPEcs
 {
+	template <class DataTuple>
+	struct ViewFunction;
+
+	template <class ... Data>
+	struct ViewFunction<std::tuple<Data...>>
+	{
+		using Type = std::function<void(Entity, ComponentReference<Data>...)>;
+	};
+
 	template <class ... Components>
 	class View : public GenericView
 	{
 		static_assert(sizeof...(Components) > 0, "A view can't consist of 0 components!");
 		public:
+			using Function = typename ViewFunction<DataComponents<Components...>>::Type;
+
 			virtual ~View() override = default;
 
 			decltype(auto) Get(Entity aEntity) const;
 
-			void ForEach(std::function<void(Entity, Components&...)> aFunctionToRun) const;
+			void ForEach(Function aFunctionToRun) const;
+
+		private:
+			template <class ... Data>
+			decltype(auto) Get(Entity aEntity, std::tuple<Data...>*) const;
+
+			template <class ... Data>
+			void ForEach(const Function& aFunctionToRun, std::tuple<Data...>*) const;
 	};
 
 	template <class ... Components>
 	decltype(auto) View<Components...>::Get(Entity aEntity) const
 	{
-		if constexpr(sizeof...(Components) == 1)
+		return Get(aEntity, static_cast<DataComponents<Components...>*>(nullptr));
+	}
+
+	template <class ... Components>
+	template <class ... Data>
+	decltype(auto) View<Components...>::Get(Entity aEntity, std::tuple<Data...>*) const
+	{
+		static_assert(sizeof...(Data) > 0, "The view only consists of tag components which carry no data!");
+
+		if constexpr(sizeof...(Data) == 1)
 		{
-			return myECS->GetComponent<Components...>(aEntity);
+			return myECS->GetComponent<Data...>(aEntity);
 		}
 		else
 		{
-			return std::tie(myECS->GetComponent<Components>(aEntity)...);
+			return std::tie(myECS->GetComponent<Data>(aEntity)...);
 		}
 	}
 
 	template <class ... Components>
-	void View<Components...>::ForEach(std::function<void(Entity, Components&...)> aFunctionToRun) const
+	void View<Components...>::ForEach(Function aFunctionToRun) const
+	{
+		ForEach(aFunctionToRun, static_cast<DataComponents<Components...>*>(nullptr));
+	}
+
+	template <class ... Components>
+	template <class ... Data>
+	void View<Components...>::ForEach(const Function& aFunctionToRun, std::tuple<Data...>*) const
 	{
 		for (auto entity : myEntities)
 		{
-			aFunctionToRun(entity, myECS->GetComponent<Components>(entity)...);
+			aFunctionToRun(entity, myECS->GetComponent<Data>(entity)...);
 		}
 	}
 
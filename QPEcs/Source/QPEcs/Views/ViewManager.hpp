@@ -1,5 +1,7 @@
 #pragma once
 #include "GenericView.hpp"
+#include "QPEcs/EntityManager.hpp"
+#include "QPEcs/Threading.hpp"
 namespace QPEcs
 {
 	template <class ... Components>
@@ -11,7 +13,7 @@ namespace QPEcs
 		using TypeName = const char*;
 	public:
 		ViewManager() = delete;
-		explicit ViewManager(ComponentManager* aComponentManager);
+		explicit ViewManager(ComponentManager* aComponentManager, EntityManager* aEntityManager);
 
 		template <class ... Components>
 		inline void RegisterView(EntityComponentSystem* aECS);
@@ -19,25 +21,43 @@ namespace QPEcs
 		template <class ... Components>
 		inline bool IsRegistered();
 
+		template <class ... Components>
+		inline void SetViewPolicy(ViewPolicy aPolicy);
+
 		inline void OnEntityDestroyed(Entity aEntity);
 
-		inline void OnEntitySignatureChanged(Entity aEntity, Signature aEntitySignature);
+		// Only views that contain one of aChangedComponents are updated, other views can't gain or lose the entity.
+		inline void OnEntitySignatureChanged(Entity aEntity, Signature aEntitySignature, Signature aChangedComponents);
+
+		inline void OnEntitySignatureChanged(Entity aEntity, Signature aEntitySignature, ComponentType aChangedComponent);
 
 		template <class ... Components>
 		inline std::shared_ptr<View<Components...>> GetView();
 	private:
 		ComponentManager* myComponentManager { nullptr };
+		EntityManager* myEntityManager { nullptr };
 		std::unordered_map<TypeName, std::shared_ptr<GenericView>> myViews {};
 		std::unordered_map<TypeName, Signature> myViewSignatures {};
+		mutable SharedMutex myMutex {};
 
 		template <class ... Components>
 		inline TypeName GetTypeName();
+
+		inline void UpdateMembership(GenericView& aView, const Signature& aViewSignature, Entity aEntity, const Signature& aEntitySignature);
+
+		inline void FlushPendingEntities(GenericView& aView, const Signature& aViewSignature);
 	};
 
 	template <class ... Components>
 	void ViewManager::RegisterView(EntityComponentSystem* aECS)
 	{
-		assert(!myViews.contains(GetTypeName<View<Components...>>()) && "View has already been registered!");
+		WriteLock lock(myMutex);
+		if (myViews.contains(GetTypeName<View<Components...>>()))
+		{
+			// Another thread registered it while we were waiting for the lock.
+			return;
+		}
+
 		myViews[GetTypeName<View<Components...>>()] = std::make_shared<View<Components...>>();
 		myViews[GetTypeName<View<Components...>>()]->myECS = aECS;
 
@@ -49,14 +69,39 @@ namespace QPEcs
 	template <class ... Components>
 	bool ViewManager::IsRegistered()
 	{
+		ReadLock lock(myMutex);
 		return myViews.contains(GetTypeName<View<Components...>>());
 	}
 
 	template <class ... Components>
-	std::shared_ptr<View<Components...>> ViewManager::GetView()
+	void ViewManager::SetViewPolicy(ViewPolicy aPolicy)
 	{
+		WriteLock lock(myMutex);
 		assert(myViews.contains(GetTypeName<View<Components...>>()) && "View hasn't been registered!");
-		return std::static_pointer_cast<View<Components...>>(myViews[GetTypeName<View<Components...>>()]);
+
+		GenericView& view = *myViews.at(GetTypeName<View<Components...>>());
+		FlushPendingEntities(view, myViewSignatures.at(GetTypeName<View<Components...>>()));
+		view.myPolicy = aPolicy;
+	}
+
+	template <class ... Components>
+	std::shared_ptr<View<Components...>> ViewManager::GetView()
+	{
+		std::shared_ptr<GenericView> view;
+		{
+			ReadLock lock(myMutex);
+			assert(myViews.contains(GetTypeName<View<Components...>>()) && "View hasn't been registered!");
+
+			view = myViews.at(GetTypeName<View<Components...>>());
+			if (view->myPendingEntities.empty())
+			{
+				return std::static_pointer_cast<View<Components...>>(view);
+			}
+		}
+
+		WriteLock lock(myMutex);
+		FlushPendingEntities(*view, myViewSignatures.at(GetTypeName<View<Components...>>()));
+		return std::static_pointer_cast<View<Components...>>(view);
 	}
 
 	template <class ... Components>
@@ -65,33 +110,87 @@ namespace QPEcs
 		return typeid(View<Components...>).name();
 	}
 
-	inline ViewManager::ViewManager(ComponentManager* aComponentManager)
+	inline ViewManager::ViewManager(ComponentManager* aComponentManager, EntityManager* aEntityManager)
 		: myComponentManager(aComponentManager)
+		, myEntityManager(aEntityManager)
 	{
 	}
 
 	inline void ViewManager::OnEntityDestroyed(Entity aEntity)
 	{
+		WriteLock lock(myMutex);
 		for (auto& [typeName, view] : myViews)
 		{
-			view->myEntities.erase(aEntity);
+			if (view->myPolicy == ViewPolicy::Lazy)
+			{
+				// The signature is cleared once the entity is destroyed, so the flush will erase it.
+				UpdateMembership(*view, myViewSignatures[typeName], aEntity, {});
+			}
+			else
+			{
+				view->myEntities.erase(aEntity);
+			}
 		}
 	}
 
-	inline void ViewManager::OnEntitySignatureChanged(Entity aEntity, Signature aEntitySignature)
+	inline void ViewManager::OnEntitySignatureChanged(Entity aEntity, Signature aEntitySignature, Signature aChangedComponents)
 	{
+		WriteLock lock(myMutex);
 		for (auto const& [typeName, view] : myViews)
 		{
 			const auto& viewSignature = myViewSignatures[typeName];
+			if ((viewSignature & aChangedComponents).any())
+			{
+				UpdateMembership(*view, viewSignature, aEntity, aEntitySignature);
+			}
+		}
+	}
+
+	inline void ViewManager::OnEntitySignatureChanged(Entity aEntity, Signature aEntitySignature, ComponentType aChangedComponent)
+	{
+		OnEntitySignatureChanged(aEntity, aEntitySignature, Signature {}.set(aChangedComponent));
+	}
+
+	inline void ViewManager::UpdateMembership(GenericView& aView, const Signature& aViewSignature, Entity aEntity, const Signature& aEntitySignature)
+	{
+		if (aView.myPolicy == ViewPolicy::Lazy)
+		{
+			if (!aView.myIsPending.test(aEntity))
+			{
+				aView.myIsPending.set(aEntity);
+				aView.myPendingEntities.push_back(aEntity);
+			}
+			return;
+		}
+
+		if ((aEntitySignature & aViewSignature) == aViewSignature)
+		{
+			aView.myEntities.insert(aEntity);
+		}
+		else
+		{
+			aView.myEntities.erase(aEntity);
+		}
+	}
 
-			if ((aEntitySignature & viewSignature) == viewSignature)
+	inline void ViewManager::FlushPendingEntities(GenericView& aView, const Signature& aViewSignature)
+	{
+		for (Entity entity : aView.myPendingEntities)
+		{
+			const Signature entitySignature = myEntityManager->IsValid(entity) ? myEntityManager->GetSignature(entity) : Signature {};
+
+			if ((entitySignature & aViewSignature) == aViewSignature)
 			{
-				view->myEntities.insert(aEntity);
+				aView.myEntities.insert(entity);
 			}
 			else
 			{
-				view->myEntities.erase(aEntity);
+				aView.myEntities.erase(entity);
 			}
+
+			aView.myIsPending.reset(entity);
 		}
+
+		aView.myPendingEntities.clear();
 	}
 }
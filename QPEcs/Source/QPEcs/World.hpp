@@ -0,0 +1,327 @@
+#pragma once
+#include "Entity.hpp"
+#include "Component.h"
+#include "EntityManager.hpp"
+#include "ComponentRegistry.hpp"
+#include "Threading.hpp"
+#include <bitset>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+
+namespace QPEcs
+{
+	// An alternative to EntityComponentSystem for a component set known at compile time.
+	// Component types are resolved at compile time and storages are held directly, so there's
+	// no registration, no virtual calls and signatures are exactly as wide as the component list.
+	template <class ... Components>
+	class World
+	{
+		static_assert(sizeof...(Components) > 0, "A world can't consist of 0 components!");
+		static_assert(sizeof...(Components) <= MaxComponents, "Number of components exceeding max components!");
+
+		public:
+			using Signature = std::bitset<sizeof...(Components)>;
+
+			World();
+			~World() = default;
+
+			// Returns NullEntity when MaxEntities are already alive.
+			Entity CreateEntity();
+
+			void DestroyEntity(Entity aEntity);
+
+			bool IsValidEntity(Entity aEntity) const;
+
+			template <class Component>
+			static constexpr ComponentType GetComponentType();
+
+			template <class Component>
+			bool HasComponent(Entity aEntity) const;
+
+			// Returns a reference to the added component, or nothing for tag components.
+			template <class Component, typename ... Args>
+			decltype(auto) AddComponent(Entity aEntity, Args&&... aArgs);
+
+			template <class Component>
+			void RemoveComponent(Entity aEntity);
+
+			template <class Component>
+			void TryCopyComponent(Entity aFrom, Entity aTo);
+
+			template <class ... CopiedComponents>
+			void TryCopyComponents(Entity aFrom, Entity aTo);
+
+			template <class Component>
+			ComponentReference<Component> GetComponent(Entity aEntity);
+
+			template <class Component, typename ... Args>
+			decltype(auto) GetOrAddComponent(Entity aEntity, Args&&... aArgs);
+
+			template <class Component, typename Function>
+			void PatchComponent(Entity aEntity, Function&& aFunction);
+
+			template <class Component>
+			std::vector<Entity> FindByIndex(const typename ComponentIndex<Component>::Key& aKey) const;
+
+			template <class Component>
+			std::vector<Entity> FindByIndexRange(const typename ComponentIndex<Component>::Key& aMin, const typename ComponentIndex<Component>::Key& aMax) const;
+
+			// Calls aFunction(Entity, Data&...) for every entity that has all of ViewComponents,
+			// tag components are matched but not passed and indexed components are passed as const.
+			// Without components every entity is visited.
+			template <class ... ViewComponents, typename Function>
+			void ForEach(Function&& aFunction);
+
+		private:
+			struct TagStorage {};
+
+			template <class Component>
+			using Storage = std::conditional_t<IsTagComponent<Component>, TagStorage, ComponentRegistry<Component>>;
+
+			std::unique_ptr<BasicEntityManager<Signature>> myEntityManager;
+			std::unique_ptr<std::tuple<Storage<Components>...>> myStorages;
+			std::unique_ptr<EntityAccessChecker> myEntityAccessChecker;
+
+			template <class Component>
+			ComponentRegistry<Component>& GetStorage() const;
+
+			template <class Component>
+			void RemoveOnDestroy(Entity aEntity, const Signature& aSignature);
+
+			template <class ... ViewComponents>
+			static constexpr Signature GetSignature();
+
+			template <class Function, class ... Data>
+			void ForEachMatching(const Signature& aSignature, Function& aFunction, std::tuple<Data...>*);
+	};
+
+	template <class ... Components>
+	World<Components...>::World()
+	{
+		myEntityManager = std::make_unique<BasicEntityManager<Signature>>();
+		myStorages = std::make_unique<std::tuple<Storage<Components>...>>();
+		myEntityAccessChecker = std::make_unique<EntityAccessChecker>();
+	}
+
+	template <class ... Components>
+	Entity World<Components...>::CreateEntity()
+	{
+		return myEntityManager->CreateEntity();
+	}
+
+	template <class ... Components>
+	void World<Components...>::DestroyEntity(Entity aEntity)
+	{
+		EntityAccessChecker::Scope accessScope(*myEntityAccessChecker, aEntity);
+		if (!myEntityManager->IsValid(aEntity))
+		{
+			return;
+		}
+
+		const Signature signature = myEntityManager->GetSignature(aEntity);
+		(RemoveOnDestroy<Components>(aEntity, signature), ...);
+
+		myEntityManager->DestroyEntity(aEntity);
+	}
+
+	template <class ... Components>
+	bool World<Components...>::IsValidEntity(Entity aEntity) const
+	{
+		return myEntityManager->IsValid(aEntity);
+	}
+
+	template <class ... Components>
+	template <class Component>
+	constexpr ComponentType World<Components...>::GetComponentType()
+	{
+		static_assert((std::is_same_v<Component, Components> || ...), "Component isn't part of this world!");
+
+		constexpr bool matches[] = { std::is_same_v<Component, Components>... };
+		ComponentType componentType = 0;
+		while (!matches[componentType])
+		{
+			componentType++;
+		}
+
+		return componentType;
+	}
+
+	template <class ... Components>
+	template <class Component>
+	bool World<Components...>::HasComponent(Entity aEntity) const
+	{
+		return myEntityManager->GetSignature(aEntity).test(GetComponentType<Component>());
+	}
+
+	template <class ... Components>
+	template <class Component, typename ... Args>
+	decltype(auto) World<Components...>::AddComponent(Entity aEntity, Args&&... aArgs)
+	{
+		EntityAccessChecker::Scope accessScope(*myEntityAccessChecker, aEntity);
+		assert(!HasComponent<Component>(aEntity) && "Entity already has component");
+
+		if constexpr (!IsTagComponent<Component>)
+		{
+			GetStorage<Component>().AddComponent(aEntity, std::forward<Args>(aArgs)...);
+		}
+
+		auto signature = myEntityManager->GetSignature(aEntity);
+		signature.set(GetComponentType<Component>());
+		myEntityManager->SetSignature(aEntity, signature);
+
+		if constexpr (!IsTagComponent<Component>)
+		{
+			return GetStorage<Component>().GetComponent(aEntity);
+		}
+	}
+
+	template <class ... Components>
+	template <class Component>
+	void World<Components...>::RemoveComponent(Entity aEntity)
+	{
+		// Claim the entity before checking, so a conflicting change can't slip in between the check and the removal.
+		EntityAccessChecker::Scope accessScope(*myEntityAccessChecker, aEntity);
+		if (HasComponent<Component>(aEntity))
+		{
+			if constexpr (!IsTagComponent<Component>)
+			{
+				GetStorage<Component>().RemoveComponent(aEntity);
+			}
+
+			auto signature = myEntityManager->GetSignature(aEntity);
+			signature.reset(GetComponentType<Component>());
+			myEntityManager->SetSignature(aEntity, signature);
+		}
+	}
+
+	template <class ... Components>
+	template <class Component>
+	void World<Components...>::TryCopyComponent(Entity aFrom, Entity aTo)
+	{
+		EntityAccessChecker::Scope fromAccessScope(*myEntityAccessChecker, aFrom);
+		EntityAccessChecker::Scope toAccessScope(*myEntityAccessChecker, aTo);
+		if (!HasComponent<Component>(aFrom))
+		{
+			return;
+		}
+
+		if constexpr (!IsTagComponent<Component>)
+		{
+			GetStorage<Component>().CopyComponent(aFrom, aTo);
+		}
+
+		auto signature = myEntityManager->GetSignature(aTo);
+		signature.set(GetComponentType<Component>());
+		myEntityManager->SetSignature(aTo, signature);
+	}
+
+	template <class ... Components>
+	template <class ... CopiedComponents>
+	void World<Components...>::TryCopyComponents(Entity aFrom, Entity aTo)
+	{
+		((TryCopyComponent<CopiedComponents>(aFrom, aTo)), ...);
+	}
+
+	template <class ... Components>
+	template <class Component>
+	ComponentReference<Component> World<Components...>::GetComponent(Entity aEntity)
+	{
+		static_assert(!IsTagComponent<Component>, "Tag components carry no data, use HasComponent instead!");
+		return GetStorage<Component>().GetComponent(aEntity);
+	}
+
+	template <class ... Components>
+	template <class Component, typename ... Args>
+	decltype(auto) World<Components...>::GetOrAddComponent(Entity aEntity, Args&&... aArgs)
+	{
+		EntityAccessChecker::Scope accessScope(*myEntityAccessChecker, aEntity);
+		if constexpr (IsTagComponent<Component>)
+		{
+			if (!HasComponent<Component>(aEntity))
+			{
+				AddComponent<Component>(aEntity, std::forward<Args>(aArgs)...);
+			}
+		}
+		else
+		{
+			if (!HasComponent<Component>(aEntity))
+			{
+				return AddComponent<Component>(aEntity, std::forward<Args>(aArgs)...);
+			}
+
+			return GetComponent<Component>(aEntity);
+		}
+	}
+
+	template <class ... Components>
+	template <class Component, typename Function>
+	void World<Components...>::PatchComponent(Entity aEntity, Function&& aFunction)
+	{
+		EntityAccessChecker::Scope accessScope(*myEntityAccessChecker, aEntity);
+		GetStorage<Component>().PatchComponent(aEntity, std::forward<Function>(aFunction));
+	}
+
+	template <class ... Components>
+	template <class Component>
+	std::vector<Entity> World<Components...>::FindByIndex(const typename ComponentIndex<Component>::Key& aKey) const
+	{
+		return GetStorage<Component>().FindByIndex(aKey);
+	}
+
+	template <class ... Components>
+	template <class Component>
+	std::vector<Entity> World<Components...>::FindByIndexRange(const typename ComponentIndex<Component>::Key& aMin, const typename ComponentIndex<Component>::Key& aMax) const
+	{
+		return GetStorage<Component>().FindByIndexRange(aMin, aMax);
+	}
+
+	template <class ... Components>
+	template <class ... ViewComponents, typename Function>
+	void World<Components...>::ForEach(Function&& aFunction)
+	{
+		constexpr Signature viewSignature = GetSignature<ViewComponents...>();
+		ForEachMatching(viewSignature, aFunction, static_cast<DataComponents<ViewComponents...>*>(nullptr));
+	}
+
+	template <class ... Components>
+	template <class Function, class ... Data>
+	void World<Components...>::ForEachMatching(const Signature& aSignature, Function& aFunction, std::tuple<Data...>*)
+	{
+		myEntityManager->ForEachEntity([&](Entity aEntity)
+		{
+			if ((myEntityManager->GetSignature(aEntity) & aSignature) == aSignature)
+			{
+				aFunction(aEntity, GetStorage<Data>().GetComponent(aEntity)...);
+			}
+		});
+	}
+
+	template <class ... Components>
+	template <class Component>
+	ComponentRegistry<Component>& World<Components...>::GetStorage() const
+	{
+		static_assert(!IsTagComponent<Component>, "Tag components don't have a registry!");
+		return std::get<GetComponentType<Component>()>(*myStorages);
+	}
+
+	template <class ... Components>
+	template <class Component>
+	void World<Components...>::RemoveOnDestroy(Entity aEntity, const Signature& aSignature)
+	{
+		if constexpr (!IsTagComponent<Component>)
+		{
+			if (aSignature.test(GetComponentType<Component>()))
+			{
+				GetStorage<Component>().RemoveComponent(aEntity);
+			}
+		}
+	}
+
+	template <class ... Components>
+	template <class ... ViewComponents>
+	constexpr typename World<Components...>::Signature World<Components...>::GetSignature()
+	{
+		return Signature((0ULL | ... | (1ULL << GetComponentType<ViewComponents>())));
+	}
+}